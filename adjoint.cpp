@@ -0,0 +1,52 @@
+#include "adjoint.h"
+
+thread_local Tape *Tape::active = nullptr;
+
+Var Tape::variable(double value)
+{
+    starts.push_back(args.size());
+    return Var(value, size() - 1);
+}
+
+Var Tape::record(double value, int n, const Var *arg, const double *partial)
+{
+    int first = args.size();
+    for (int k = 0; k < n; ++k)
+    {
+        if (arg[k].index < 0 || partial[k] == 0.0)
+            continue;
+        args.push_back(arg[k].index);
+        partials.push_back(partial[k]);
+    }
+    // all constant arguments give a constant
+    if ((int)args.size() == first)
+        return Var(value);
+
+    starts.push_back(args.size());
+    return Var(value, size() - 1);
+}
+
+void Tape::backward(const Var &output)
+{
+    adjoints.assign(size(), 0.0);
+    if (output.index < 0)
+        return;
+
+    adjoints[output.index] = 1.0;
+    for (int node = output.index; node >= 0; --node)
+    {
+        double adjoint = adjoints[node];
+        if (adjoint == 0.0)
+            continue;
+        for (int k = starts[node]; k < starts[node + 1]; ++k)
+            adjoints[args[k]] += partials[k] * adjoint;
+    }
+}
+
+void Tape::clear()
+{
+    starts.resize(1);
+    args.clear();
+    partials.clear();
+    adjoints.clear();
+}
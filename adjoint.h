@@ -0,0 +1,127 @@
+#ifndef ADJOINT_H
+#define ADJOINT_H
+
+#include <cmath>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+    Reverse mode automatic differentiation. Every operation on a Var records a
+    node on the active Tape holding the partial derivatives of its result with
+    respect to its arguments. One backward sweep from an output then gives the
+    derivative of that output with respect to every input recorded before it,
+    at a cost of a few times the forward pass however many inputs there are.
+    Var built from a plain double are constants and never reach the tape.
+*/
+
+struct Var
+{
+    double value;
+    int index; // node on the active tape, -1 for a constant
+
+    Var(double value = 0.0) : value(value), index(-1) {}
+    Var(double value, int index) : value(value), index(index) {}
+};
+
+class Tape
+{
+    std::vector<int> starts;      // first partial of each node, one extra entry closes the last node
+    std::vector<int> args;        // node each partial is taken with respect to
+    std::vector<double> partials; // d node / d argument
+    std::vector<double> adjoints; // d output / d node after backward()
+
+public:
+    // Tape that operations on Var are recorded to, one per thread
+    static thread_local Tape *active;
+
+    Tape() { starts.push_back(0); }
+
+    // New independent input
+    Var variable(double value);
+
+    // Records a node for a result depending on n arguments, constant arguments and zero partials are dropped
+    Var record(double value, int n, const Var *arg, const double *partial);
+
+    // Sweeps back from output, afterwards adjoint(v) is d output / d v
+    void backward(const Var &output);
+    double adjoint(const Var &v) const { return v.index < 0 ? 0.0 : adjoints[v.index]; }
+
+    // Forgets all nodes but keeps the memory for the next recording
+    void clear();
+    int size() const { return starts.size() - 1; }
+};
+
+// Makes a tape the active one for the lifetime of the guard
+class ActiveTape
+{
+    Tape *previous;
+
+public:
+    ActiveTape(Tape &tape) : previous(Tape::active) { Tape::active = &tape; }
+    ~ActiveTape() { Tape::active = previous; }
+};
+
+inline Var record(double value, const Var &a, double da)
+{
+    if (a.index < 0)
+        return Var(value);
+    return Tape::active->record(value, 1, &a, &da);
+}
+
+inline Var record(double value, const Var &a, double da, const Var &b, double db)
+{
+    if (a.index < 0 && b.index < 0)
+        return Var(value);
+    Var arg[2] = {a, b};
+    double partial[2] = {da, db};
+    return Tape::active->record(value, 2, arg, partial);
+}
+
+inline Var operator+(const Var &a, const Var &b) { return record(a.value + b.value, a, 1.0, b, 1.0); }
+inline Var operator-(const Var &a, const Var &b) { return record(a.value - b.value, a, 1.0, b, -1.0); }
+inline Var operator*(const Var &a, const Var &b) { return record(a.value * b.value, a, b.value, b, a.value); }
+inline Var operator/(const Var &a, const Var &b)
+{
+    double value = a.value / b.value;
+    return record(value, a, 1.0 / b.value, b, -value / b.value);
+}
+inline Var operator-(const Var &a) { return record(-a.value, a, -1.0); }
+
+inline Var operator+(const Var &a, double b) { return record(a.value + b, a, 1.0); }
+inline Var operator+(double a, const Var &b) { return record(a + b.value, b, 1.0); }
+inline Var operator-(const Var &a, double b) { return record(a.value - b, a, 1.0); }
+inline Var operator-(double a, const Var &b) { return record(a - b.value, b, -1.0); }
+inline Var operator*(const Var &a, double b) { return record(a.value * b, a, b); }
+inline Var operator*(double a, const Var &b) { return record(a * b.value, b, a); }
+inline Var operator/(const Var &a, double b) { return record(a.value / b, a, 1.0 / b); }
+inline Var operator/(double a, const Var &b)
+{
+    double value = a / b.value;
+    return record(value, b, -value / b.value);
+}
+
+inline Var exp(const Var &a)
+{
+    double value = std::exp(a.value);
+    return record(value, a, value);
+}
+
+inline Var log(const Var &a) { return record(std::log(a.value), a, 1.0 / a.value); }
+
+inline Var sqrt(const Var &a)
+{
+    double value = std::sqrt(a.value);
+    return record(value, a, 0.5 / value);
+}
+
+inline Var erfc(const Var &a)
+{
+    return record(std::erfc(a.value), a, -2.0 / std::sqrt(M_PI) * std::exp(-a.value * a.value));
+}
+
+// the derivative follows whichever argument is taken
+inline Var max(const Var &a, const Var &b) { return a.value >= b.value ? a : b; }
+#endif
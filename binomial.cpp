@@ -1,44 +1,308 @@
 #include "binomial.h"
+#include "parallel.h"
+#include <cfloat>
+
+// Nodes per block and time steps per tile of the tiled backward induction, a
+// block of values and prices (64KB) stays in L2 while its tile is worked
+static const int tile_width = 4096;
+static const int tile_depth = 512;
+
+// Trees from this many steps on are rolled back in tiles, with one thread as well
+static const int tiled_min_steps = 4 * tile_width;
 
 /*          Base Class          */
 
 // Destructor if necessary
 Binomial::~Binomial() {}
 
-/*          Derived Class : European Call Binomial          */
+double Binomial::european_rollback(double R, double Rinv, bool call) const
+{
+    double u, p_up;
+    lattice_moves(sigma, t / steps, R, u, p_up);
+    double d = 1.0 / u;         // down movement
+    double p_down = 1.0 - p_up; // probability of downward
 
-// Destructor if necessary
-Euro_call_bin::~Euro_call_bin() {}
+    std::vector<double> prices(steps + 1); // price of underlying
+    prices[0] = S * std::pow(d, steps);    // fill in endnodes
 
-void Euro_call_bin::print()
-{
-    std::cout << "Euro Call Approx: " << Euro_call_bin::option_price() << std::endl;
+    for (int i = 1; i <= steps; ++i)
+        prices[i] = prices[i - 1] * u * u;
+
+    std::vector<double> values(steps + 1); // value of corresponding option
+    for (int i = 0; i <= steps; ++i)
+        values[i] = std::max(0.0, call ? prices[i] - K : K - prices[i]);
+
+    if (steps >= tiled_min_steps)
+        return tiled_rollback(values, prices, u, p_up, Rinv, call, false);
+
+    for (int step = steps - 1; step >= 0; --step)
+    {
+        for (int i = 0; i <= step; ++i)
+            values[i] = (p_up * values[i + 1] + p_down * values[i]) * Rinv;
+    }
+    return values[0];
 }
 
-double Euro_call_bin::option_price() const
+double Binomial::american_rollback(double R, double Rinv, bool call) const
 {
-    double R = std::exp((r - q) * (t / steps));        // interest rate for each step
-    double Rinv = 1.0 / R;                             // inverse of interest rate
-    double u = std::exp(sigma * std::sqrt(t / steps)); // up movement
-    double d = 1.0 / u;                                // down movement
-    double p_up = (R - d) / (u - d);                   // probability of upward
-    double p_down = 1.0 - p_up;                        // probability of downward
+    double u, p_up;
+    lattice_moves(sigma, t / steps, R, u, p_up);
+    double d = 1.0 / u;         // down movement
+    double p_down = 1.0 - p_up; // probability of downward
+    bool degenerate = p_up < 0.0 || p_up > 1.0;
+
+    // One step of continuation is worth at least Rinv * (R * S - K) for a call and
+    // Rinv * (K - R * S) for a put, when that beats intrinsic at every node in the
+    // money the option is never exercised early and the European tree is enough
+    if (!degenerate)
+    {
+        if (call && R >= 1.0 && R * Rinv >= 1.0)
+            return european_rollback(R, Rinv, call);
+        if (!call && R <= 1.0 && Rinv >= 1.0)
+            return european_rollback(R, Rinv, call);
+    }
 
-    std::vector<double> prices(steps + 1); // price of underlying
-    prices[0] = S * pow(d, steps);         // fill in endnodes
+    // The opposite bound, a node whose two children are exercised is exercised too
+    bool banded = !degenerate && (call ? R <= 1.0 && R * Rinv <= 1.0 : R >= 1.0 && Rinv <= 1.0);
 
+    // Prices are only kept for the endnodes, node i at step n is prices[i] * u^(steps - n)
+    std::vector<double> prices(steps + 1);
+    prices[0] = S * std::pow(d, steps);
     for (int i = 1; i <= steps; ++i)
         prices[i] = prices[i - 1] * u * u;
+    double shift = 1.0;
 
-    std::vector<double> call_values(steps + 1); // value of corresponding call
+    std::vector<double> values(steps + 1); // value of corresponding option
     for (int i = 0; i <= steps; ++i)
-        call_values[i] = std::max(0.0, (prices[i] - K));
-    for (int step = steps - 1; step >= 0; --step)
+        values[i] = std::max(0.0, call ? prices[i] - K : K - prices[i]);
+
+    // the tiled path checks every node, so it needs neither the band nor a fallback
+    if (steps >= tiled_min_steps)
+        return tiled_rollback(values, prices, u, p_up, Rinv, call, true);
+
+    // steps too coarse for the volatility give p_up outside [0, 1] and the
+    // exercise region is no longer contiguous, check every node then
+    if (!banded)
     {
-        for (int i = 0; i <= step; ++i)
-            call_values[i] = (p_up * call_values[i + 1] + p_down * call_values[i]) * Rinv;
+        for (int step = steps - 1; step >= 0; --step)
+        {
+            shift *= u;
+            for (int i = 0; i <= step; ++i)
+            {
+                double exercise = call ? prices[i] * shift - K : K - prices[i] * shift;
+                values[i] = std::max((p_up * values[i + 1] + p_down * values[i]) * Rinv, exercise);
+            }
+        }
+        return values[0];
+    }
+
+    /*
+        The exercise region is contiguous: the bottom nodes [0, ex) for a put and
+        the top nodes [ex, step] for a call. A node whose two children are both
+        exercised is exercised as well, so it is filled with intrinsic directly.
+        Only the band next to the boundary compares continuation and intrinsic,
+        everything past the first node that is not exercised is continuation only.
+    */
+    int ex = 0;
+    if (call)
+    {
+        while (ex <= steps && prices[ex] < K)
+            ++ex;
+
+        for (int step = steps - 1; step >= 0; --step)
+        {
+            shift *= u;
+            // walking down the level, so keep the old value of the node above
+            double upper = values[step + 1];
+            int i = step;
+            for (; i >= ex; --i)
+            {
+                upper = values[i];
+                values[i] = prices[i] * shift - K;
+            }
+            ex = i + 1;
+            for (; i >= 0; --i)
+            {
+                double cont = (p_up * upper + p_down * values[i]) * Rinv;
+                double exercise = prices[i] * shift - K;
+                upper = values[i];
+                if (exercise < cont)
+                {
+                    values[i] = cont;
+                    break;
+                }
+                values[i] = exercise;
+                ex = i;
+            }
+            for (--i; i >= 0; --i)
+            {
+                double cont = (p_up * upper + p_down * values[i]) * Rinv;
+                upper = values[i];
+                values[i] = cont;
+            }
+        }
     }
-    return call_values[0];
+    else
+    {
+        while (ex <= steps && prices[ex] <= K)
+            ++ex;
+
+        for (int step = steps - 1; step >= 0; --step)
+        {
+            shift *= u;
+            int i = 0;
+            for (; i < ex - 1; ++i)
+                values[i] = K - prices[i] * shift;
+            ex = i;
+            for (; i <= step; ++i)
+            {
+                double cont = (p_up * values[i + 1] + p_down * values[i]) * Rinv;
+                double exercise = K - prices[i] * shift;
+                if (exercise < cont)
+                {
+                    values[i] = cont;
+                    break;
+                }
+                values[i] = exercise;
+                ex = i + 1;
+            }
+            for (++i; i <= step; ++i)
+                values[i] = (p_up * values[i + 1] + p_down * values[i]) * Rinv;
+        }
+    }
+    return values[0];
+}
+
+double Binomial::tiled_rollback(std::vector<double> &values, const std::vector<double> &prices,
+                                double u, double p_up, double Rinv, bool call, bool american) const
+{
+    double p_down = 1.0 - p_up;
+
+    // value of node i one level back from its down and up children, values far
+    // out of the money decay into subnormals that are very slow to work with on
+    // large trees and are flushed to zero instead
+    auto node = [&](double down, double up, int i, double sh)
+    {
+        double value = (p_up * up + p_down * down) * Rinv;
+        if (american)
+            value = std::max(value, call ? prices[i] * sh - K : K - prices[i] * sh);
+        return std::fabs(value) < DBL_MIN ? 0.0 : value;
+    };
+
+    // node for node over [lo, hi), each from values[i] and values[i + 1]
+    auto row = [&](int lo, int hi, double sh)
+    {
+        double *v = values.data();
+        const double *x = prices.data();
+        if (!american)
+        {
+            for (int i = lo; i < hi; ++i)
+            {
+                double value = (p_up * v[i + 1] + p_down * v[i]) * Rinv;
+                v[i] = std::fabs(value) < DBL_MIN ? 0.0 : value;
+            }
+        }
+        else if (call)
+        {
+            for (int i = lo; i < hi; ++i)
+            {
+                double value = (p_up * v[i + 1] + p_down * v[i]) * Rinv;
+                double exercise = x[i] * sh - K;
+                v[i] = exercise > value ? exercise : std::fabs(value) < DBL_MIN ? 0.0 : value;
+            }
+        }
+        else
+        {
+            for (int i = lo; i < hi; ++i)
+            {
+                double value = (p_up * v[i + 1] + p_down * v[i]) * Rinv;
+                double exercise = K - x[i] * sh;
+                v[i] = exercise > value ? exercise : std::fabs(value) < DBL_MIN ? 0.0 : value;
+            }
+        }
+    };
+
+    /*
+        Each tile takes depth time steps at once. The level is cut into blocks
+        [a, b) of tile_width nodes (the last block takes the remainder) and every
+        block first works the trapezoid it can reach on its own, nodes [a, b - s)
+        after s steps, saving the values at a before they are overwritten. Once
+        all blocks are done the triangle [b - s, b) left at the right edge of each
+        block is filled in using the saved values of the block above it.
+    */
+    int max_blocks = std::max(1, (steps + 1) / tile_width);
+    std::vector<double> ghosts(max_blocks * tile_depth);
+
+    // the threads are started once for the whole tree and meet at a barrier
+    // after each phase, every one walks the same levels and keeps its own shift
+    int team = std::max(1, std::min(threads, max_blocks));
+    Barrier barrier(team);
+    parallel_team(team, [&](int id, int count)
+    {
+        double shift = 1.0; // node i of the current level is prices[i] * shift
+        int level = steps;
+        while (level > 0)
+        {
+            int depth = std::min(tile_depth, level);
+            int blocks = std::max(1, (level + 1) / tile_width);
+            int first = blocks * id / count, last = blocks * (id + 1) / count;
+
+            // trapezoids
+            for (int k = first; k < last; ++k)
+            {
+                bool top = k + 1 == blocks;
+                int a = k * tile_width;
+                int b = top ? level + 1 : a + tile_width;
+                double sh = shift;
+                for (int s = 1; s <= depth; ++s)
+                {
+                    sh *= u;
+                    ghosts[k * depth + s - 1] = values[a];
+                    row(a, top ? level - s + 1 : b - s, sh);
+                }
+            }
+            barrier.wait();
+
+            // triangles
+            for (int k = first; k < last; ++k)
+            {
+                if (k + 1 == blocks)
+                    continue;
+                int b = (k + 1) * tile_width;
+                const double *ghost = &ghosts[(k + 1) * depth];
+                double sh = shift;
+                for (int s = 1; s <= depth; ++s)
+                {
+                    sh *= u;
+                    row(b - s, b - 1, sh);
+                    values[b - 1] = node(values[b - 1], ghost[s - 1], b - 1, sh);
+                }
+            }
+            barrier.wait();
+
+            for (int s = 0; s < depth; ++s)
+                shift *= u;
+            level -= depth;
+        }
+    });
+    return values[0];
+}
+
+/*          Derived Class : European Call Binomial          */
+
+// Destructor if necessary
+Euro_call_bin::~Euro_call_bin() {}
+
+void Euro_call_bin::print()
+{
+    std::cout << "Euro Call Approx: " << Euro_call_bin::option_price() << std::endl;
+}
+
+double Euro_call_bin::option_price() const
+{
+    double R, Rinv;
+    lattice_rates(r, q, t / steps, false, R, Rinv);
+    return european_rollback(R, Rinv, true);
 }
 
 /*          Derived Class : European Put Binomial          */
@@ -53,29 +317,9 @@ void Euro_put_bin::print()
 
 double Euro_put_bin::option_price() const
 {
-    double R = std::exp((r - q) * (t / steps));        // interest rate for each step
-    double Rinv = 1.0 / R;                             // inverse of interest rate
-    double u = std::exp(sigma * std::sqrt(t / steps)); // up movement
-    double d = 1.0 / u;                                // down movement
-    double p_up = (R - d) / (u - d);                   // probability of upward
-    double p_down = 1.0 - p_up;                        // probability of downward
-
-    std::vector<double> prices(steps + 1); // price of underlying
-    prices[0] = S * pow(d, steps);         // fill in endnodes
-
-    for (int i = 1; i <= steps; ++i)
-        prices[i] = prices[i - 1] * u * u;
-
-    std::vector<double> put_values(steps + 1); // value of corresponding call
-    for (int i = 0; i <= steps; ++i)
-        put_values[i] = std::max(0.0, (K - prices[i]));
-
-    for (int step = steps - 1; step >= 0; --step)
-    {
-        for (int i = 0; i <= step; ++i)
-            put_values[i] = (p_up * put_values[i + 1] + p_down * put_values[i]) * Rinv;
-    }
-    return put_values[0];
+    double R, Rinv;
+    lattice_rates(r, q, t / steps, false, R, Rinv);
+    return european_rollback(R, Rinv, false);
 }
 
 /*          Derived Class : American Call Binomial          */
@@ -90,37 +334,9 @@ void American_call::print()
 
 double American_call::option_price() const
 {
-    double R = std::exp((r - q) * (t / steps));        // interest rate for each step
-    double Rinv = 1.0 / R;                             // inverse of interest rate
-    double u = std::exp(sigma * std::sqrt(t / steps)); // up movement
-    double d = 1.0 / u;                                // down movement
-    double p_up = (R - d) / (u - d);                   // probability of upward
-    double p_down = 1.0 - p_up;                        // probability of downward
-
-    std::vector<double> prices(steps + 1); // price of underlying
-
-    // Set up prices at maturity
-    prices[0] = S * std::pow(d, steps);
-    for (int i = 1; i <= steps; ++i)
-        prices[i] = prices[i - 1] * u * u;
-
-    std::vector<double> call_values(steps + 1); // value of corresponding call
-
-    // Calculate call payoffs at maturity
-    for (int i = 0; i <= steps; ++i)
-        call_values[i] = std::max(0.0, (prices[i] - K));
-
-    // Step back through tree
-    for (int step = steps - 1; step >= 0; --step)
-    {
-        for (int i = 0; i <= step; ++i)
-        {
-            call_values[i] = (p_up * call_values[i + 1] + p_down * call_values[i]) * Rinv;
-            prices[i] = d * prices[i + 1];
-            call_values[i] = std::max(call_values[i], prices[i] - K); // check for exercise
-        }
-    }
-    return call_values[0];
+    double R, Rinv;
+    lattice_rates(r, q, t / steps, false, R, Rinv);
+    return american_rollback(R, Rinv, true);
 }
 
 /*          Derived Class : American Put Binomial          */
@@ -135,37 +351,9 @@ void American_put::print()
 
 double American_put::option_price() const
 {
-    double R = std::exp((r - q) * (t / steps));        // interest rate for each step
-    double Rinv = 1.0 / R;                             // inverse of interest rate
-    double u = std::exp(sigma * std::sqrt(t / steps)); // up movement
-    double d = 1.0 / u;                                // down movement
-    double p_up = (R - d) / (u - d);                   // probability of upward
-    double p_down = 1.0 - p_up;                        // probability of downward
-
-    std::vector<double> prices(steps + 1); // price of underlying
-
-    // Set up prices at maturity
-    prices[0] = S * std::pow(d, steps);
-    for (int i = 1; i <= steps; ++i)
-        prices[i] = prices[i - 1] * u * u;
-
-    std::vector<double> put_values(steps + 1); // value of corresponding call
-
-    // Calculate call payoffs at maturity
-    for (int i = 0; i <= steps; ++i)
-        put_values[i] = std::max(0.0, (K - prices[i]));
-
-    // Step back through tree
-    for (int step = steps - 1; step >= 0; --step)
-    {
-        for (int i = 0; i <= step; ++i)
-        {
-            put_values[i] = (p_up * put_values[i + 1] + p_down * put_values[i]) * Rinv;
-            prices[i] = prices[i + 1] / u;
-            put_values[i] = std::max(put_values[i], K - prices[i]); // check for exercise
-        }
-    }
-    return put_values[0];
+    double R, Rinv;
+    lattice_rates(r, q, t / steps, false, R, Rinv);
+    return american_rollback(R, Rinv, false);
 }
 
 /*          Derived Class : American Call on Future Binomial          */
@@ -180,36 +368,9 @@ void American_future_call::print()
 
 double American_future_call::option_price() const
 {
-    double Rinv = std::exp(-r * (t / steps));          // inverse of interest rate
-    double u = std::exp(sigma * std::sqrt(t / steps)); // up movement
-    double d = 1.0 / u;                                // down movement
-    double p_up = (1 - d) / (u - d);                   // probability of upward
-    double p_down = 1.0 - p_up;                        // probability of downward
-
-    std::vector<double> prices(steps + 1); // price of underlying
-
-    // Set up prices at maturity
-    prices[0] = S * std::pow(d, steps);
-    for (int i = 1; i <= steps; ++i)
-        prices[i] = prices[i - 1] * u * u;
-
-    std::vector<double> call_values(steps + 1); // value of corresponding call
-
-    // Calculate call payoffs at maturity
-    for (int i = 0; i <= steps; ++i)
-        call_values[i] = std::max(0.0, (prices[i] - K));
-
-    // Step back through tree
-    for (int step = steps - 1; step >= 0; --step)
-    {
-        for (int i = 0; i <= step; ++i)
-        {
-            call_values[i] = (p_up * call_values[i + 1] + p_down * call_values[i]) * Rinv;
-            prices[i] = d * prices[i + 1];
-            call_values[i] = std::max(call_values[i], prices[i] - K); // check for exercise
-        }
-    }
-    return call_values[0];
+    double R, Rinv;
+    lattice_rates(r, q, t / steps, true, R, Rinv);
+    return american_rollback(R, Rinv, true);
 }
 
 /*          Derived Class : American Put on Future Binomial          */
@@ -224,34 +385,7 @@ void American_future_put::print()
 
 double American_future_put::option_price() const
 {
-    double Rinv = std::exp(-r * (t / steps));          // inverse of interest rate
-    double u = std::exp(sigma * std::sqrt(t / steps)); // up movement
-    double d = 1.0 / u;                                // down movement
-    double p_up = (1 - d) / (u - d);                   // probability of upward
-    double p_down = 1.0 - p_up;                        // probability of downward
-
-    std::vector<double> prices(steps + 1); // price of underlying
-
-    // Set up prices at maturity
-    prices[0] = S * std::pow(d, steps);
-    for (int i = 1; i <= steps; ++i)
-        prices[i] = prices[i - 1] * u * u;
-
-    std::vector<double> put_values(steps + 1); // value of corresponding call
-
-    // Calculate call payoffs at maturity
-    for (int i = 0; i <= steps; ++i)
-        put_values[i] = std::max(0.0, (K - prices[i]));
-
-    // Step back through tree
-    for (int step = steps - 1; step >= 0; --step)
-    {
-        for (int i = 0; i <= step; ++i)
-        {
-            put_values[i] = (p_up * put_values[i + 1] + p_down * put_values[i]) * Rinv;
-            prices[i] = prices[i + 1] * d;
-            put_values[i] = std::max(put_values[i], K - prices[i]); // check for exercise
-        }
-    }
-    return put_values[0];
+    double R, Rinv;
+    lattice_rates(r, q, t / steps, true, R, Rinv);
+    return american_rollback(R, Rinv, false);
 }
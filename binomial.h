@@ -1,14 +1,50 @@
+#ifndef BINOMIAL_H
+#define BINOMIAL_H
+
 #include <cmath>
 #include <vector>
 #include <iostream>
 #include <algorithm>
 
+/*
+    Set up of the lattice on any scalar type with the arithmetic of double and
+    exp and sqrt found for it, so the classes below and the adjoint
+    sensitivities of portfolio_risk.h build the very same tree.
+*/
+
+// Growth R of the underlying and discount Rinv over one step of length dt, futures grow at 1 per step
+template <class T>
+void lattice_rates(const T &r, const T &q, const T &dt, bool future, T &R, T &Rinv)
+{
+    using std::exp;
+    if (future)
+    {
+        R = T(1.0);
+        Rinv = exp(-r * dt); // inverse of interest rate
+        return;
+    }
+    R = exp((r - q) * dt); // interest rate for each step
+    Rinv = 1.0 / R;        // inverse of interest rate
+}
+
+// Up movement u (down is 1 / u) and probability p_up of an up movement over one step of length dt
+template <class T>
+void lattice_moves(const T &sigma, const T &dt, const T &R, T &u, T &p_up)
+{
+    using std::exp;
+    using std::sqrt;
+    u = exp(sigma * sqrt(dt)); // up movement
+    T d = 1.0 / u;             // down movement
+    p_up = (R - d) / (u - d);  // probability of upward
+}
+
 class Binomial
 {
 
 protected:
     double S, K, r, q, sigma, t;
     int steps;
+    int threads;
 
     /*
         S - underlying price per share
@@ -18,11 +54,26 @@ protected:
         sigma - volatility
         t - time to expiration (years)
         steps - number of iterations
+        threads - threads used to roll back very large trees (1 keeps it serial)
     */
 
+    // Backward induction shared by the lattice pricers
+    // R - growth of the underlying per step, Rinv - discount per step, call - payoff is S - K
+    double european_rollback(double R, double Rinv, bool call) const;
+
+    // Same as european_rollback but with early exercise, only the nodes on the
+    // exercise boundary are checked, nodes behind it are filled with intrinsic
+    double american_rollback(double R, double Rinv, bool call) const;
+
+    // Backward induction for very large trees, several time steps are taken per
+    // cache resident block of the level and the blocks are spread over threads
+    // values - payoffs at maturity, prices - underlying at maturity
+    double tiled_rollback(std::vector<double> &values, const std::vector<double> &prices,
+                          double u, double p_up, double Rinv, bool call, bool american) const;
+
 public:
     // Constructor initalizes member variables
-    Binomial(double S, double K, double r, double q, double sigma, double t, int steps) : S(S), K(K), r(r), q(q), sigma(sigma), t(t), steps(steps) {}
+    Binomial(double S, double K, double r, double q, double sigma, double t, int steps) : S(S), K(K), r(r), q(q), sigma(sigma), t(t), steps(steps), threads(1) {}
     // destructor if necessary
     virtual ~Binomial();
 
@@ -33,6 +84,7 @@ public:
     virtual void set_sigma(const double &sigma) { this->sigma = sigma; }
     virtual void set_t(const double &t) { this->t = t; }
     virtual void set_steps(const int &steps) { this->steps = steps; }
+    virtual void set_threads(const int &threads) { this->threads = threads; }
 
     // Function to print outputs of member functions
     virtual void print() = 0;
@@ -130,4 +182,5 @@ public:
 
     // redefining the option price
     double option_price() const override;
-};
\ No newline at end of file
+};
+#endif
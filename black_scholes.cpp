@@ -8,8 +8,7 @@ BlackScholes::~BlackScholes() {}
 
 double BlackScholes::norm_cdf(const double &x) const
 {
-    // uses the relation of erfc(x) = 1-erf(x) 
-    return 0.5 * std::erfc(-x * M_SQRT1_2);
+    return normal_cdf(x);
 }
 
 double BlackScholes::norm_pdf(const double &x) const
@@ -35,11 +34,7 @@ void Euro_call::print()
 
 double Euro_call::option_price() const
 {
-    // standard BS call formula
-    double d1 = (std::log(S / K) + (r - q + sigma * sigma * 0.5) * t) / (sigma * std::sqrt(t));
-    double d2 = d1 - sigma * std::sqrt(t);
-
-    return S * std::exp(-q * t) * norm_cdf(d1) - K * std::exp(-r * t) * norm_cdf(d2);
+    return euro_call_price(S, K, r, q, sigma, t);
 }
 
 double Euro_call::calc_delta() const
@@ -100,10 +95,7 @@ void Euro_put::print()
 
 double Euro_put::option_price() const
 {
-    // standard BS call formula
-    double d1 = (std::log(S / K) + (r + sigma * sigma * 0.5) * t) / (sigma * std::sqrt(t));
-    double d2 = d1 - sigma * std::sqrt(t);
-    return K * std::exp(-r * t) * norm_cdf(-d2) - S * std::exp(-q * t) * norm_cdf(-d1);
+    return euro_put_price(S, K, r, q, sigma, t);
 }
 
 double Euro_put::calc_delta() const
@@ -159,10 +151,7 @@ void Euro_future_call::print()
 
 double Euro_future_call::option_price() const
 {
-    // BS price of a future call
-    double d1 = (std::log(S / K) + (0.5 * sigma * sigma * t)) / (sigma * std::sqrt(t));
-    double d2 = d1 - sigma * std::sqrt(t);
-    return std::exp(-r * t) * (S * norm_cdf(d1) - K * norm_cdf(d2));
+    return euro_future_call_price(S, K, r, sigma, t);
 }
 
 // function to implement greeks if necessary
@@ -184,10 +173,7 @@ void Euro_future_put::print()
 
 double Euro_future_put::option_price() const
 {
-    // BS price of a future put
-    double d1 = (std::log(S / K) + (sigma * sigma * 0.5 * t)) / (sigma * std::sqrt(t));
-    double d2 = d1 - sigma * std::sqrt(t);
-    return std::exp(-r * t) * (K * norm_cdf(-d2) - S * norm_cdf(-d1));
+    return euro_future_put_price(S, K, r, sigma, t);
 }
 
 // function to implement greeks if necessary
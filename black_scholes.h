@@ -13,6 +13,67 @@
 #define M_SQRT1_2 0.7071067811865476
 #endif
 
+/*
+    Closed form prices on any scalar type with the arithmetic of double and
+    log, exp, sqrt and erfc found for it, so the classes below and the adjoint
+    sensitivities of portfolio_risk.h evaluate the very same formulas.
+*/
+
+template <class T>
+T normal_cdf(const T &x)
+{
+    using std::erfc;
+    // uses the relation of erfc(x) = 1-erf(x)
+    return 0.5 * erfc(-x * M_SQRT1_2);
+}
+
+template <class T>
+T euro_call_price(const T &S, double K, const T &r, const T &q, const T &sigma, const T &t)
+{
+    using std::exp;
+    using std::log;
+    using std::sqrt;
+    // standard BS call formula
+    T d1 = (log(S / K) + (r - q + sigma * sigma * 0.5) * t) / (sigma * sqrt(t));
+    T d2 = d1 - sigma * sqrt(t);
+    return S * exp(-q * t) * normal_cdf(d1) - K * exp(-r * t) * normal_cdf(d2);
+}
+
+template <class T>
+T euro_put_price(const T &S, double K, const T &r, const T &q, const T &sigma, const T &t)
+{
+    using std::exp;
+    using std::log;
+    using std::sqrt;
+    T d1 = (log(S / K) + (r + sigma * sigma * 0.5) * t) / (sigma * sqrt(t));
+    T d2 = d1 - sigma * sqrt(t);
+    return K * exp(-r * t) * normal_cdf(-d2) - S * exp(-q * t) * normal_cdf(-d1);
+}
+
+template <class T>
+T euro_future_call_price(const T &S, double K, const T &r, const T &sigma, const T &t)
+{
+    using std::exp;
+    using std::log;
+    using std::sqrt;
+    // BS price of a future call
+    T d1 = (log(S / K) + (0.5 * sigma * sigma * t)) / (sigma * sqrt(t));
+    T d2 = d1 - sigma * sqrt(t);
+    return exp(-r * t) * (S * normal_cdf(d1) - K * normal_cdf(d2));
+}
+
+template <class T>
+T euro_future_put_price(const T &S, double K, const T &r, const T &sigma, const T &t)
+{
+    using std::exp;
+    using std::log;
+    using std::sqrt;
+    // BS price of a future put
+    T d1 = (log(S / K) + (sigma * sigma * 0.5 * t)) / (sigma * sqrt(t));
+    T d2 = d1 - sigma * sqrt(t);
+    return exp(-r * t) * (K * normal_cdf(-d2) - S * normal_cdf(-d1));
+}
+
 class BlackScholes
 {
 protected:
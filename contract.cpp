@@ -0,0 +1,64 @@
+#include "contract.h"
+#include "parallel.h"
+
+bool is_lattice(int product)
+{
+    return product >= EURO_CALL_BIN && product < PRODUCT_COUNT;
+}
+
+bool valid_contract(const Contract &c)
+{
+    if (c.product < 0 || c.product >= PRODUCT_COUNT)
+        return false;
+    if (!(c.S > 0.0 && c.K > 0.0 && c.sigma > 0.0 && c.t > 0.0))
+        return false;
+    if (!std::isfinite(c.S + c.K + c.r + c.q + c.sigma + c.t))
+        return false;
+    return !is_lattice(c.product) || c.steps > 0;
+}
+
+double price_contract(const Contract &c)
+{
+    switch (c.product)
+    {
+    case EURO_CALL:
+        return Euro_call(c.S, c.K, c.r, c.q, c.sigma, c.t).option_price();
+    case EURO_PUT:
+        return Euro_put(c.S, c.K, c.r, c.q, c.sigma, c.t).option_price();
+    case EURO_FUTURE_CALL:
+        return Euro_future_call(c.S, c.K, c.r, c.q, c.sigma, c.t).option_price();
+    case EURO_FUTURE_PUT:
+        return Euro_future_put(c.S, c.K, c.r, c.q, c.sigma, c.t).option_price();
+    case EURO_CALL_BIN:
+        return Euro_call_bin(c.S, c.K, c.r, c.q, c.sigma, c.t, c.steps).option_price();
+    case EURO_PUT_BIN:
+        return Euro_put_bin(c.S, c.K, c.r, c.q, c.sigma, c.t, c.steps).option_price();
+    case AMERICAN_CALL:
+        return American_call(c.S, c.K, c.r, c.q, c.sigma, c.t, c.steps).option_price();
+    case AMERICAN_PUT:
+        return American_put(c.S, c.K, c.r, c.q, c.sigma, c.t, c.steps).option_price();
+    case AMERICAN_FUTURE_CALL:
+        return American_future_call(c.S, c.K, c.r, c.q, c.sigma, c.t, c.steps).option_price();
+    case AMERICAN_FUTURE_PUT:
+        return American_future_put(c.S, c.K, c.r, c.q, c.sigma, c.t, c.steps).option_price();
+    }
+    return NAN;
+}
+
+void price_batch(const Contract *contracts, double *prices, int n, int threads)
+{
+    parallel_ranges(n, threads, [&](int first, int last)
+    {
+        for (int i = first; i < last; ++i)
+            prices[i] = price_contract(contracts[i]);
+    });
+}
+
+void price_batch(const Contract *contracts, double *prices, int n, ThreadTeam &team)
+{
+    team.run(n, [&](int first, int last)
+    {
+        for (int i = first; i < last; ++i)
+            prices[i] = price_contract(contracts[i]);
+    });
+}
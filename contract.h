@@ -0,0 +1,52 @@
+#ifndef CONTRACT_H
+#define CONTRACT_H
+
+#include "black_scholes.h"
+#include "binomial.h"
+
+class ThreadTeam;
+
+// Products that can be priced from a Contract, the values are also the product codes on the wire
+enum Product
+{
+    EURO_CALL = 0,
+    EURO_PUT = 1,
+    EURO_FUTURE_CALL = 2,
+    EURO_FUTURE_PUT = 3,
+    EURO_CALL_BIN = 4,
+    EURO_PUT_BIN = 5,
+    AMERICAN_CALL = 6,
+    AMERICAN_PUT = 7,
+    AMERICAN_FUTURE_CALL = 8,
+    AMERICAN_FUTURE_PUT = 9,
+    PRODUCT_COUNT = 10
+};
+
+struct Contract
+{
+    int product;
+    double S, K, r, q, sigma, t;
+    int steps;
+
+    /*
+        product - one of Product
+        S, K, r, q, sigma, t - as in BlackScholes and Binomial
+        steps - number of iterations, only used by the lattice products
+    */
+};
+
+// True for products priced on a binomial lattice
+bool is_lattice(int product);
+
+// Checks the product code and that the inputs give a finite price
+bool valid_contract(const Contract &c);
+
+// Prices one contract with the matching BlackScholes or Binomial class (NAN for an unknown product)
+double price_contract(const Contract &c);
+
+// Prices contracts[0, n) into prices[0, n), spread over threads
+void price_batch(const Contract *contracts, double *prices, int n, int threads);
+
+// Same, spread over the threads of a team kept by the caller
+void price_batch(const Contract *contracts, double *prices, int n, ThreadTeam &team);
+#endif
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "pricing_server.h"
+
+/*
+    Load generator for the pricing daemon (fin serve). Every connection keeps
+    window requests in flight, cycling through all products around the money,
+    and the latency of each request is measured from its write to its response.
+*/
+
+typedef std::chrono::steady_clock Clock;
+
+struct Load
+{
+    std::string path;
+    int connections, requests, window, steps;
+};
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static Request make_request(uint32_t id, int steps)
+{
+    Request req;
+    std::memset(&req, 0, sizeof(req));
+    req.id = id;
+    req.product = id % PRODUCT_COUNT;
+    req.steps = steps;
+    req.S = 90.0 + (id % 200) * 0.1;
+    req.K = 100.0;
+    req.r = 0.05;
+    req.q = 0.02;
+    req.sigma = 0.25;
+    req.t = 1.0;
+    return req;
+}
+
+// Runs one connection, latencies[id] is filled in microseconds, false if the connection failed
+static bool run_connection(const Load &load, std::vector<double> &latencies, int &errors)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, load.path.c_str(), sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::perror(load.path.c_str());
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    std::vector<Clock::time_point> sent(load.requests);
+    int next = 0, received = 0;
+    bool ok = true;
+    while (ok && received < load.requests)
+    {
+        // top the window up, then wait for one response
+        std::vector<Request> batch;
+        for (; next < load.requests && next - received < load.window; ++next)
+        {
+            batch.push_back(make_request(next, load.steps));
+            sent[next] = Clock::now();
+        }
+        if (!batch.empty())
+            ok = write_all(fd, (const char *)batch.data(), batch.size() * sizeof(Request));
+
+        Response res;
+        if (ok && (ok = read_all(fd, (char *)&res, sizeof(res))))
+        {
+            if (res.id < (uint32_t)load.requests)
+                latencies[res.id] = std::chrono::duration<double, std::micro>(Clock::now() - sent[res.id]).count();
+            if (res.status != PRICE_OK)
+                ++errors;
+            ++received;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: fin_load <socket> [connections] [requests per connection] [window] [steps]" << std::endl;
+        return 1;
+    }
+    Load load;
+    load.path = argv[1];
+    load.connections = argc > 2 ? std::atoi(argv[2]) : 4;
+    load.requests = argc > 3 ? std::atoi(argv[3]) : 10000;
+    load.window = argc > 4 ? std::atoi(argv[4]) : 64;
+    load.steps = argc > 5 ? std::atoi(argv[5]) : 100;
+
+    std::vector<std::vector<double>> latencies(load.connections, std::vector<double>(load.requests));
+    std::vector<int> errors(load.connections, 0);
+    std::vector<char> ok(load.connections, 0);
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < load.connections; ++c)
+        clients.emplace_back([&, c] { ok[c] = run_connection(load, latencies[c], errors[c]); });
+    for (auto &th : clients)
+        th.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    int failed = 0;
+    for (int c = 0; c < load.connections; ++c)
+    {
+        if (!ok[c])
+            continue;
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        failed += errors[c];
+    }
+    if (all.empty())
+        return 1;
+    std::sort(all.begin(), all.end());
+
+    auto percentile = [&](double p) { return all[std::min(all.size() - 1, (size_t)(p * all.size()))]; };
+    std::cout << "Requests: " << all.size() << " (" << failed << " errors) in " << seconds << " s" << std::endl;
+    std::cout << "Throughput: " << all.size() / seconds << " req/s" << std::endl;
+    std::cout << "Latency us p50: " << percentile(0.50) << " p90: " << percentile(0.90)
+              << " p99: " << percentile(0.99) << " max: " << all.back() << std::endl;
+    return 0;
+}
@@ -1,9 +1,53 @@
 #include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include <string>
 #include "black_scholes.h"
 #include "binomial.h"
+#include "pricing_server.h"
+#include "portfolio_risk.h"
 
-int main()
+static PricingServer *server = nullptr;
+
+static void handle_signal(int)
+{
+    if (server)
+        server->stop();
+}
+
+// fin serve <socket> [workers] [max batch] [threads per batch] [queue capacity] [cache entries]
+static int serve(int argc, char **argv)
 {
+    if (argc < 3)
+    {
+        std::cerr << "usage: fin serve <socket> [workers] [max batch] [threads per batch] [queue capacity] [cache entries]"
+                  << std::endl;
+        return 1;
+    }
+    int workers = argc > 3 ? std::atoi(argv[3]) : 2;
+    int max_batch = argc > 4 ? std::atoi(argv[4]) : 256;
+    int threads = argc > 5 ? std::atoi(argv[5]) : 1;
+    int queue_capacity = argc > 6 ? std::atoi(argv[6]) : 4096;
+    long cache_entries = argc > 7 ? std::atol(argv[7]) : 1 << 20;
+
+    PricingServer pricing(argv[2], workers, max_batch, threads, queue_capacity, std::max(0L, cache_entries));
+    if (!pricing.start())
+        return 1;
+
+    server = &pricing;
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+    std::cout << "Pricing on " << argv[2] << std::endl;
+    pricing.run();
+    server = nullptr;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "serve")
+        return serve(argc, argv);
+
     double S = 100;      // spot
     double K = 95;      // strike
     double t = 1;        // time to maturity (years)
@@ -38,6 +82,19 @@ int main()
     fut.print();
     Euro_future_put fup(S, K, r, q, sigma, t);
     fup.print();
+    std::cout << std::endl;
+
+    // sensitivities of a small book from one adjoint sweep
+    std::vector<Position> book = {{"ABC", 10, {EURO_FUTURE_CALL, S, K, r, q, sigma, t, 0}},
+                                  {"ABC", -5, {AMERICAN_PUT, S, K, r, q, sigma, t, 100}},
+                                  {"XYZ", 2, {EURO_CALL, S, K, r, q, sigma, t, 0}}};
+    PortfolioRisk risk = portfolio_risk(book);
+    for (auto &entry : risk.underlyings)
+    {
+        const Sensitivities &s = entry.second;
+        std::cout << entry.first << " PV: " << s.pv << " dS: " << s.dS << " dsigma: " << s.dsigma
+                  << " dr: " << s.dr << " dq: " << s.dq << " dt: " << s.dt << std::endl;
+    }
 
     return 0;
 }
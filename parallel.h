@@ -0,0 +1,141 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Splits [0, n) into contiguous ranges, one per thread, and runs work(first, last) on each
+// the calling thread takes the first range so threads = 1 never starts a thread
+template <class Work>
+void parallel_ranges(int n, int threads, Work work)
+{
+    int count = std::max(1, std::min(n, threads));
+    std::vector<std::thread> pool;
+    for (int j = 1; j < count; ++j)
+        pool.emplace_back(work, n * j / count, n * (j + 1) / count);
+    work(0, n / count);
+    for (auto &th : pool)
+        th.join();
+}
+
+// Runs work(id, count) once on each of count = threads threads, ids 0 to count - 1,
+// the calling thread takes id 0. For work that goes through several phases with
+// a Barrier between them, the threads are started once instead of per phase
+template <class Work>
+void parallel_team(int threads, Work work)
+{
+    int count = std::max(1, threads);
+    std::vector<std::thread> pool;
+    for (int j = 1; j < count; ++j)
+        pool.emplace_back(work, j, count);
+    work(0, count);
+    for (auto &th : pool)
+        th.join();
+}
+
+// Blocks each of count threads in wait() until all of them have called it, reusable
+class Barrier
+{
+    std::mutex lock;
+    std::condition_variable released;
+    int count, waiting;
+    long generation;
+
+public:
+    explicit Barrier(int count) : count(count), waiting(0), generation(0) {}
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        long arrived = generation;
+        if (++waiting == count)
+        {
+            waiting = 0;
+            ++generation;
+            released.notify_all();
+            return;
+        }
+        released.wait(guard, [&] { return generation != arrived; });
+    }
+};
+
+// Threads kept across calls, for callers that split work many times a second. run()
+// splits [0, n) the way parallel_ranges does without starting a thread, the calling
+// thread takes the first range. One caller at a time.
+class ThreadTeam
+{
+    std::mutex lock;
+    std::condition_variable started, finished;
+    std::function<void(int, int)> work;
+    int n, count, running;
+    long generation;
+    bool quitting;
+    std::vector<std::thread> pool;
+
+    void helper(int id)
+    {
+        long seen = 0;
+        while (true)
+        {
+            int size;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                started.wait(guard, [&] { return quitting || generation != seen; });
+                if (quitting)
+                    return;
+                seen = generation;
+                size = n;
+            }
+            // work is not touched by run() until every helper has finished with it
+            work(size * id / count, size * (id + 1) / count);
+            std::lock_guard<std::mutex> guard(lock);
+            if (--running == 0)
+                finished.notify_one();
+        }
+    }
+
+public:
+    explicit ThreadTeam(int threads) : n(0), count(std::max(1, threads)), running(0), generation(0), quitting(false)
+    {
+        for (int j = 1; j < count; ++j)
+            pool.emplace_back(&ThreadTeam::helper, this, j);
+    }
+
+    ~ThreadTeam()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quitting = true;
+        }
+        started.notify_all();
+        for (auto &th : pool)
+            th.join();
+    }
+
+    template <class Work>
+    void run(int n, Work work)
+    {
+        // not worth waking the helpers for a single item
+        if (count == 1 || n <= 1)
+        {
+            work(0, n);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            this->work = work;
+            this->n = n;
+            running = count - 1;
+            ++generation;
+        }
+        started.notify_all();
+        work(0, n / count);
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this] { return running == 0; });
+    }
+};
+#endif
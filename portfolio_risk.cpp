@@ -0,0 +1,187 @@
+#include "portfolio_risk.h"
+#include "adjoint.h"
+
+/*
+    The closed forms are the templates of black_scholes.h evaluated on Var and
+    the lattices are built with the templates of binomial.h, so the tape holds
+    the same formulas option_price evaluates and the adjoints are derivatives
+    of what it returns.
+*/
+
+// Lattice of Binomial::european_rollback and american_rollback
+static Var lattice_price(const Contract &c, const Var &S, const Var &r, const Var &q, const Var &sigma, const Var &t,
+                         bool call, bool american, bool future)
+{
+    int steps = c.steps;
+    double K = c.K;
+    double sign = call ? 1.0 : -1.0;
+    Var dt = t / steps;
+    Var R, Rinv, u, p_up;
+    lattice_rates(r, q, dt, future, R, Rinv);
+    lattice_moves(sigma, dt, R, u, p_up);
+
+    /*
+        Recording every node would make the tape far bigger than the tree, so the
+        lattice goes on the tape as one node of S, u, p_up and Rinv, valued with
+        price_contract so it is exactly the price of the Binomial classes. Its
+        four partials are carried through the backward induction next to the
+        values, which keeps the memory at a few levels whatever the number of
+        steps. The underlying at node i of step n is S * u^(2i - n), so an
+        exercised node has partials sign * price / S for S and
+        sign * (2i - n) * price / u for u, and a continued node
+        v = (p_up * up + p_down * down) * Rinv takes those of its children.
+    */
+    size_t nodes = (size_t)steps + 1;
+    std::vector<double> prices(nodes); // underlying at maturity
+    prices[0] = S.value * std::pow(1.0 / u.value, steps);
+    for (int i = 1; i <= steps; ++i)
+        prices[i] = prices[i - 1] * u.value * u.value;
+
+    // value of node i of the current level and its partials
+    std::vector<double> values(nodes), dS(nodes, 0.0), du(nodes, 0.0), dp(nodes, 0.0), dRinv(nodes, 0.0);
+    for (int i = 0; i <= steps; ++i)
+    {
+        values[i] = std::max(0.0, sign * (prices[i] - K));
+        if (values[i] <= 0.0)
+            continue;
+        dS[i] = sign * prices[i] / S.value;
+        du[i] = sign * (2 * i - steps) * prices[i] / u.value;
+    }
+
+    double up = p_up.value, down = 1.0 - p_up.value, disc = Rinv.value, spot = S.value, move = u.value;
+    double *v = values.data(), *v_S = dS.data(), *v_u = du.data(), *v_p = dp.data(), *v_R = dRinv.data();
+    double shift = 1.0; // node i of step n is prices[i] * shift
+    for (int n = steps - 1; n >= 0; --n)
+    {
+        shift *= move;
+        for (int i = 0; i <= n; ++i)
+        {
+            double expected = up * v[i + 1] + down * v[i];
+            double cont = expected * disc;
+            double price = prices[i] * shift;
+            if (american && sign * (price - K) > cont)
+            {
+                v[i] = sign * (price - K);
+                v_S[i] = sign * price / spot;
+                v_u[i] = sign * (2 * i - n) * price / move;
+                v_p[i] = 0.0;
+                v_R[i] = 0.0;
+                continue;
+            }
+            v_S[i] = (up * v_S[i + 1] + down * v_S[i]) * disc;
+            v_u[i] = (up * v_u[i + 1] + down * v_u[i]) * disc;
+            v_p[i] = (v[i + 1] - v[i] + up * v_p[i + 1] + down * v_p[i]) * disc;
+            v_R[i] = expected + (up * v_R[i + 1] + down * v_R[i]) * disc;
+            v[i] = cont;
+        }
+    }
+
+    Var arg[4] = {S, u, p_up, Rinv};
+    double partial[4] = {dS[0], du[0], dp[0], dRinv[0]};
+    return Tape::active->record(price_contract(c), 4, arg, partial);
+}
+
+static Var price_on_tape(const Contract &c, const Var &S, const Var &r, const Var &q, const Var &sigma, const Var &t)
+{
+    double K = c.K;
+    switch (c.product)
+    {
+    case EURO_CALL:
+        return euro_call_price(S, K, r, q, sigma, t);
+    case EURO_PUT:
+        return euro_put_price(S, K, r, q, sigma, t);
+    case EURO_FUTURE_CALL:
+        return euro_future_call_price(S, K, r, sigma, t);
+    case EURO_FUTURE_PUT:
+        return euro_future_put_price(S, K, r, sigma, t);
+    case EURO_CALL_BIN:
+        return lattice_price(c, S, r, q, sigma, t, true, false, false);
+    case EURO_PUT_BIN:
+        return lattice_price(c, S, r, q, sigma, t, false, false, false);
+    case AMERICAN_CALL:
+        return lattice_price(c, S, r, q, sigma, t, true, true, false);
+    case AMERICAN_PUT:
+        return lattice_price(c, S, r, q, sigma, t, false, true, false);
+    case AMERICAN_FUTURE_CALL:
+        return lattice_price(c, S, r, q, sigma, t, true, true, true);
+    case AMERICAN_FUTURE_PUT:
+        return lattice_price(c, S, r, q, sigma, t, false, true, true);
+    }
+    return Var(NAN);
+}
+
+static void accumulate(Sensitivities &sum, const Sensitivities &s)
+{
+    sum.pv += s.pv;
+    sum.dS += s.dS;
+    sum.dsigma += s.dsigma;
+    sum.dr += s.dr;
+    sum.dq += s.dq;
+    sum.dt += s.dt;
+}
+
+PortfolioRisk portfolio_risk(const std::vector<Position> &positions)
+{
+    const Sensitivities zero = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    int n = positions.size();
+
+    PortfolioRisk risk;
+    risk.total = zero;
+    risk.positions.assign(n, zero);
+
+    struct Inputs
+    {
+        Var S, r, q, sigma, t;
+    };
+    std::vector<Inputs> inputs(n);
+
+    // forward pass, the whole book on one tape
+    Tape tape;
+    ActiveTape guard(tape);
+    Var pv = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        const Contract &c = positions[i].contract;
+        if (!valid_contract(c))
+        {
+            risk.positions[i].pv = NAN;
+            continue;
+        }
+        Inputs &in = inputs[i];
+        in.S = tape.variable(c.S);
+        in.r = tape.variable(c.r);
+        in.q = tape.variable(c.q);
+        in.sigma = tape.variable(c.sigma);
+        in.t = tape.variable(c.t);
+
+        Var price = price_on_tape(c, in.S, in.r, in.q, in.sigma, in.t);
+        risk.positions[i].pv = positions[i].quantity * price.value;
+        pv = pv + positions[i].quantity * price;
+    }
+
+    // one backward pass for every input of every position
+    tape.backward(pv);
+    for (int i = 0; i < n; ++i)
+    {
+        if (!valid_contract(positions[i].contract))
+            continue;
+        Sensitivities &s = risk.positions[i];
+        const Inputs &in = inputs[i];
+        s.dS = tape.adjoint(in.S);
+        s.dsigma = tape.adjoint(in.sigma);
+        s.dr = tape.adjoint(in.r);
+        s.dq = tape.adjoint(in.q);
+        s.dt = tape.adjoint(in.t);
+
+        accumulate(risk.total, s);
+        auto it = risk.underlyings.insert(std::make_pair(positions[i].underlying, zero)).first;
+        accumulate(it->second, s);
+    }
+    return risk;
+}
+
+Sensitivities contract_risk(const Contract &c)
+{
+    Position position = {"", 1.0, c};
+    return portfolio_risk(std::vector<Position>(1, position)).positions[0];
+}
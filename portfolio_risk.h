@@ -0,0 +1,46 @@
+#ifndef PORTFOLIO_RISK_H
+#define PORTFOLIO_RISK_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "contract.h"
+
+struct Position
+{
+    std::string underlying;
+    double quantity;
+    Contract contract;
+
+    /*
+        underlying - name the sensitivities are aggregated under
+        quantity - number of contracts held (negative when short)
+        contract - product and inputs, see Contract
+    */
+};
+
+struct Sensitivities
+{
+    double pv, dS, dsigma, dr, dq, dt;
+
+    /*
+        pv - present value
+        dS, dsigma, dr, dq, dt - derivative of pv with respect to S, sigma, r, q
+        and t (time to expiration, so the sign is opposite to calc_theta)
+    */
+};
+
+struct PortfolioRisk
+{
+    Sensitivities total;
+    std::vector<Sensitivities> positions;             // same order as the positions, scaled by quantity
+    std::map<std::string, Sensitivities> underlyings; // sum over the positions on each underlying
+};
+
+// Prices every position on a single tape and runs one adjoint sweep for all sensitivities,
+// positions failing valid_contract get a NAN pv and are left out of the sums
+PortfolioRisk portfolio_risk(const std::vector<Position> &positions);
+
+// Sensitivities of a single contract, same as a portfolio holding one of it
+Sensitivities contract_risk(const Contract &c);
+#endif
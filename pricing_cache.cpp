@@ -0,0 +1,200 @@
+#include "pricing_cache.h"
+#include "parallel.h"
+#include <cstring>
+
+// Rounds away the low quantum_bits of the mantissa, both zeros map to the same key
+static uint64_t quantize(double x)
+{
+    if (x == 0.0)
+        return 0;
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const uint64_t half = uint64_t(1) << (quantum_bits - 1);
+    return (bits + half) >> quantum_bits;
+}
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+bool ContractKey::operator==(const ContractKey &other) const
+{
+    if (product != other.product || steps != other.steps)
+        return false;
+    for (int k = 0; k < 6; ++k)
+        if (inputs[k] != other.inputs[k])
+            return false;
+    return true;
+}
+
+size_t ContractKeyHash::operator()(const ContractKey &key) const
+{
+    uint64_t h = mix((uint64_t(key.product) << 32) | uint32_t(key.steps));
+    for (int k = 0; k < 6; ++k)
+        h = mix(h ^ key.inputs[k]);
+    return h;
+}
+
+ContractKey contract_key(const Contract &c)
+{
+    ContractKey key;
+    key.product = c.product;
+    key.steps = is_lattice(c.product) ? c.steps : 0; // steps mean nothing to the closed forms
+    key.inputs[0] = quantize(c.S);
+    key.inputs[1] = quantize(c.K);
+    key.inputs[2] = quantize(c.r);
+    key.inputs[3] = quantize(c.q);
+    key.inputs[4] = quantize(c.sigma);
+    key.inputs[5] = quantize(c.t);
+    return key;
+}
+
+PricingCache::PricingCache(size_t capacity, int shards) : hits(0), misses(0), deduplicated(0), evictions(0)
+{
+    // no shard is left without room, and the remainder goes one entry each to the first shards
+    size_t count = std::max<size_t>(1, std::min<size_t>(std::max(1, shards), capacity));
+    for (size_t i = 0; i < count; ++i)
+        this->shards.emplace_back(new Shard(capacity / count + (i < capacity % count ? 1 : 0)));
+}
+
+PricingCache::Shard &PricingCache::shard_for(const ContractKey &key)
+{
+    // high bits pick the shard, the low bits are left to the shard's hash table
+    return *shards[(uint64_t(ContractKeyHash()(key)) >> 40) % shards.size()];
+}
+
+bool PricingCache::lookup(const ContractKey &key, double &price)
+{
+    Shard &shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end())
+        return false;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    price = it->second->second;
+    return true;
+}
+
+void PricingCache::insert(const ContractKey &key, double price)
+{
+    // a failed pricing is not worth keeping
+    if (!std::isfinite(price))
+        return;
+
+    Shard &shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        // another thread priced it meanwhile
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    shard.lru.emplace_front(key, price);
+    shard.index[key] = shard.lru.begin();
+    if (shard.lru.size() > shard.capacity)
+    {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        ++evictions;
+    }
+}
+
+double PricingCache::price(const Contract &c)
+{
+    ContractKey key = contract_key(c);
+    double price;
+    if (lookup(key, price))
+    {
+        ++hits;
+        return price;
+    }
+    ++misses;
+    price = price_contract(c);
+    insert(key, price);
+    return price;
+}
+
+void PricingCache::price_batch(const Contract *contracts, double *prices, int n, int threads)
+{
+    ThreadTeam team(threads);
+    price_batch(contracts, prices, n, team);
+}
+
+void PricingCache::price_batch(const Contract *contracts, double *prices, int n, ThreadTeam &team)
+{
+    // first occurrence of each key in the batch, and where each contract takes its price from
+    std::unordered_map<ContractKey, int, ContractKeyHash> first;
+    std::vector<int> source(n);
+    std::vector<ContractKey> keys;
+    std::vector<int> unique;
+    for (int i = 0; i < n; ++i)
+    {
+        ContractKey key = contract_key(contracts[i]);
+        auto found = first.insert(std::make_pair(key, (int)unique.size()));
+        source[i] = found.first->second;
+        if (found.second)
+        {
+            keys.push_back(key);
+            unique.push_back(i);
+        }
+    }
+    deduplicated += n - unique.size();
+
+    // look the distinct contracts up, price the misses together
+    std::vector<double> unique_prices(unique.size());
+    std::vector<Contract> missing;
+    std::vector<int> missing_slot;
+    for (size_t u = 0; u < unique.size(); ++u)
+    {
+        if (lookup(keys[u], unique_prices[u]))
+            continue;
+        missing.push_back(contracts[unique[u]]);
+        missing_slot.push_back(u);
+    }
+    hits += unique.size() - missing.size();
+    misses += missing.size();
+
+    std::vector<double> missing_prices(missing.size());
+    ::price_batch(missing.data(), missing_prices.data(), missing.size(), team);
+    for (size_t m = 0; m < missing.size(); ++m)
+    {
+        unique_prices[missing_slot[m]] = missing_prices[m];
+        insert(keys[missing_slot[m]], missing_prices[m]);
+    }
+
+    for (int i = 0; i < n; ++i)
+        prices[i] = unique_prices[source[i]];
+}
+
+CacheStats PricingCache::stats() const
+{
+    CacheStats s;
+    s.hits = hits;
+    s.misses = misses;
+    s.deduplicated = deduplicated;
+    s.evictions = evictions;
+    s.entries = 0;
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->lock);
+        s.entries += shard->lru.size();
+    }
+    return s;
+}
+
+void PricingCache::clear()
+{
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->lock);
+        shard->index.clear();
+        shard->lru.clear();
+    }
+}
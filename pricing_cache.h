@@ -0,0 +1,89 @@
+#ifndef PRICING_CACHE_H
+#define PRICING_CACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "contract.h"
+
+// Contract with its inputs rounded to quantum_bits fewer mantissa bits, equal keys share a price
+struct ContractKey
+{
+    int product, steps;
+    uint64_t inputs[6]; // S, K, r, q, sigma, t
+
+    bool operator==(const ContractKey &other) const;
+};
+
+struct ContractKeyHash
+{
+    size_t operator()(const ContractKey &key) const;
+};
+
+// Low mantissa bits dropped from each input, inputs within ~1e-12 relative of each other share an entry
+const int quantum_bits = 12;
+
+ContractKey contract_key(const Contract &c);
+
+struct CacheStats
+{
+    long hits, misses, deduplicated, evictions;
+    size_t entries;
+
+    /*
+        hits - prices served from the cache
+        misses - prices computed
+        deduplicated - contracts in a batch that repeated another one of the same batch
+        evictions - entries dropped to stay within capacity
+        entries - entries currently cached
+    */
+};
+
+class PricingCache
+{
+    struct Shard
+    {
+        std::mutex lock;
+        std::list<std::pair<ContractKey, double>> lru; // most recently used first
+        std::unordered_map<ContractKey, std::list<std::pair<ContractKey, double>>::iterator, ContractKeyHash> index;
+        size_t capacity; // entries kept before the least recently used is evicted
+
+        Shard(size_t capacity) : capacity(capacity) {}
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<long> hits, misses, deduplicated, evictions;
+
+    /*
+        shards - independently locked parts of the cache, picked by key hash,
+        their capacities add up to the capacity of the cache
+    */
+
+    Shard &shard_for(const ContractKey &key);
+    bool lookup(const ContractKey &key, double &price);
+    void insert(const ContractKey &key, double price);
+
+public:
+    // Holds up to capacity prices spread over shards, fewer shards when capacity is smaller than shards
+    PricingCache(size_t capacity, int shards = 16);
+
+    // Cached price of c, priced with price_contract on a miss
+    double price(const Contract &c);
+
+    // Prices contracts[0, n) into prices[0, n), each distinct contract is looked up once
+    // and the misses are priced with price_batch spread over the team
+    void price_batch(const Contract *contracts, double *prices, int n, ThreadTeam &team);
+
+    // Same with a team of threads started for this call
+    void price_batch(const Contract *contracts, double *prices, int n, int threads);
+
+    CacheStats stats() const;
+
+    // Drops every entry, the statistics are kept
+    void clear();
+};
+#endif
@@ -0,0 +1,374 @@
+#include "pricing_server.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// How long stop waits for the writers to flush before cutting off clients that do not read
+static const int flush_timeout_ms = 1000;
+
+// Writes all of len bytes, false once the peer has gone away
+static bool send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+PricingServer::Connection::~Connection()
+{
+    close(fd);
+}
+
+PricingServer::PricingServer(const std::string &path, int workers, int max_batch, int threads, int queue_capacity,
+                             size_t cache_entries)
+    : path(path), workers(std::max(1, workers)), max_batch(std::max(1, max_batch)), threads(std::max(1, threads)),
+      queue_capacity(std::max(1, queue_capacity)), cache(cache_entries > 0 ? new PricingCache(cache_entries) : nullptr),
+      listen_fd(-1), stopping(false), draining(false), readers(0), writers(0), served(0), batches(0) {}
+
+PricingServer::~PricingServer()
+{
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+}
+
+bool PricingServer::start()
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        std::perror("socket");
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        std::perror(path.c_str());
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void PricingServer::run()
+{
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; ++i)
+        pool.emplace_back(&PricingServer::work_loop, this);
+
+    // poll with a timeout so stop() is noticed without another thread closing the socket
+    while (!stopping)
+    {
+        pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            // out of descriptors (EMFILE, ENFILE) the socket stays readable, wait for one to free up
+            if (errno != EINTR && errno != ECONNABORTED)
+                poll(nullptr, 0, 200);
+            continue;
+        }
+
+        std::shared_ptr<Connection> conn(new Connection(fd));
+        {
+            std::lock_guard<std::mutex> lock(conn_lock);
+            connections[fd] = conn;
+            ++readers;
+            ++writers;
+        }
+        std::thread(&PricingServer::read_loop, this, conn).detach();
+        std::thread(&PricingServer::write_loop, this, conn).detach();
+    }
+
+    close(listen_fd);
+    unlink(path.c_str());
+    listen_fd = -1;
+
+    // stop reading, answer what has already been queued, then let the workers go
+    {
+        std::unique_lock<std::mutex> lock(conn_lock);
+        for (auto &entry : connections)
+        {
+            std::shared_ptr<Connection> conn = entry.second.lock();
+            if (!conn)
+                continue;
+            shutdown(conn->fd, SHUT_RD);
+            {
+                // readers waiting on their window check stopping under the connection lock
+                std::lock_guard<std::mutex> conn_guard(conn->lock);
+            }
+            conn->changed.notify_all();
+        }
+        {
+            // readers check stopping under the queue lock, take it so the wakeup is not lost
+            std::lock_guard<std::mutex> queue_guard(queue_lock);
+        }
+        not_full.notify_all();
+        handlers_done.wait(lock, [this] { return readers == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_lock);
+        draining = true;
+    }
+    not_empty.notify_all();
+    for (auto &th : pool)
+        th.join();
+
+    // every response is with a writer now, clients still not reading after the timeout are cut off
+    {
+        std::unique_lock<std::mutex> lock(conn_lock);
+        if (!handlers_done.wait_for(lock, std::chrono::milliseconds(flush_timeout_ms), [this] { return writers == 0; }))
+        {
+            for (auto &entry : connections)
+            {
+                std::shared_ptr<Connection> conn = entry.second.lock();
+                if (conn)
+                    shutdown(conn->fd, SHUT_RDWR);
+            }
+            handlers_done.wait(lock, [this] { return writers == 0; });
+        }
+    }
+
+    std::cout << "Served " << served << " requests in " << batches << " batches" << std::endl;
+    if (cache)
+    {
+        CacheStats s = cache->stats();
+        std::cout << "Cache hits: " << s.hits << " misses: " << s.misses << " deduplicated: " << s.deduplicated
+                  << " evictions: " << s.evictions << " entries: " << s.entries << std::endl;
+    }
+}
+
+void PricingServer::read_loop(std::shared_ptr<Connection> conn)
+{
+    std::vector<char> buffer(256 * sizeof(Request));
+    size_t filled = 0;
+    bool closing = false;
+
+    while (!stopping && !closing)
+    {
+        ssize_t n = read(conn->fd, buffer.data() + filled, buffer.size() - filled);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        filled += n;
+
+        size_t count = filled / sizeof(Request);
+        size_t next = 0;
+        while (next < count)
+        {
+            // backpressure per connection, while the client is not reading its responses it is not read either
+            size_t end;
+            {
+                std::unique_lock<std::mutex> lock(conn->lock);
+                conn->changed.wait(lock, [&] { return stopping || conn->broken || conn->in_flight < connection_window; });
+                closing = stopping || conn->broken;
+                if (closing)
+                    break;
+                end = next + std::min(count - next, connection_window - conn->in_flight);
+                conn->in_flight += end - next;
+            }
+
+            // and across connections, while the queue is full nothing is read and the clients block on write
+            while (next < end)
+            {
+                std::unique_lock<std::mutex> lock(queue_lock);
+                not_full.wait(lock, [this] { return stopping || queue.size() < queue_capacity; });
+                if (stopping)
+                    break;
+                for (; next < end && queue.size() < queue_capacity; ++next)
+                {
+                    Job job;
+                    job.conn = conn;
+                    std::memcpy(&job.req, buffer.data() + next * sizeof(Request), sizeof(Request));
+                    queue.push_back(job);
+                }
+                lock.unlock();
+                not_empty.notify_one();
+            }
+            if (next < end)
+            {
+                // stopped before all of them were queued
+                std::lock_guard<std::mutex> lock(conn->lock);
+                conn->in_flight -= end - next;
+                closing = true;
+                break;
+            }
+        }
+
+        // keep the partial request at the end for the next read
+        size_t used = count * sizeof(Request);
+        std::memmove(buffer.data(), buffer.data() + used, filled - used);
+        filled -= used;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(conn->lock);
+        conn->reading = false;
+    }
+    conn->changed.notify_all();
+    handler_done(conn, readers);
+}
+
+void PricingServer::write_loop(std::shared_ptr<Connection> conn)
+{
+    std::vector<Response> out;
+    while (true)
+    {
+        {
+            // done once the reader has finished and every request it read has been answered
+            std::unique_lock<std::mutex> lock(conn->lock);
+            conn->changed.wait(lock, [&] { return !conn->outbox.empty() || (!conn->reading && conn->in_flight == 0); });
+            if (conn->outbox.empty())
+                break;
+            out.swap(conn->outbox);
+        }
+
+        bool sent = send_all(conn->fd, (const char *)out.data(), out.size() * sizeof(Response));
+        {
+            std::lock_guard<std::mutex> lock(conn->lock);
+            conn->in_flight -= out.size();
+            conn->broken = !sent;
+        }
+        conn->changed.notify_all();
+        out.clear();
+
+        if (!sent)
+        {
+            // the client is gone, wake the reader if it is still waiting on it
+            shutdown(conn->fd, SHUT_RD);
+            break;
+        }
+    }
+    handler_done(conn, writers);
+}
+
+void PricingServer::handler_done(const std::shared_ptr<Connection> &conn, int &running)
+{
+    std::lock_guard<std::mutex> lock(conn_lock);
+    if (--conn->handlers == 0)
+        connections.erase(conn->fd);
+    --running;
+    handlers_done.notify_all();
+}
+
+void PricingServer::work_loop()
+{
+    // threads each batch is spread over, started once for the life of the worker
+    ThreadTeam team(threads);
+    std::vector<Job> jobs;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queue_lock);
+            not_empty.wait(lock, [this] { return draining || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            // coalesce everything that arrived while the workers were busy
+            size_t n = std::min(queue.size(), (size_t)max_batch);
+            jobs.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.begin() + n));
+            queue.erase(queue.begin(), queue.begin() + n);
+            if (!queue.empty())
+                not_empty.notify_one();
+        }
+        not_full.notify_all();
+
+        price_jobs(jobs, team);
+        served += jobs.size();
+        ++batches;
+        jobs.clear();
+    }
+}
+
+void PricingServer::price_jobs(std::vector<Job> &jobs, ThreadTeam &team)
+{
+    int n = jobs.size();
+    std::vector<Contract> contracts(n);
+    std::vector<double> prices(n);
+    std::vector<Response> responses(n);
+
+    // only valid contracts go to the pricers, the rest are answered with their status
+    std::vector<int> priced;
+    for (int i = 0; i < n; ++i)
+    {
+        const Request &req = jobs[i].req;
+        responses[i].id = req.id;
+        responses[i].price = 0.0;
+
+        Contract c = {req.product, req.S, req.K, req.r, req.q, req.sigma, req.t, req.steps};
+        if (req.product >= PRODUCT_COUNT)
+            responses[i].status = BAD_PRODUCT;
+        else if (!valid_contract(c) || (is_lattice(c.product) && c.steps > max_request_steps))
+            responses[i].status = BAD_INPUT;
+        else
+        {
+            responses[i].status = PRICE_OK;
+            contracts[priced.size()] = c;
+            priced.push_back(i);
+        }
+    }
+
+    if (cache)
+        cache->price_batch(contracts.data(), prices.data(), priced.size(), team);
+    else
+        price_batch(contracts.data(), prices.data(), priced.size(), team);
+    for (size_t j = 0; j < priced.size(); ++j)
+        responses[priced[j]].price = prices[j];
+
+    // group by connection so each writer is woken once per batch
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return jobs[a].conn < jobs[b].conn; });
+
+    for (int i = 0; i < n;)
+    {
+        Connection *conn = jobs[order[i]].conn.get();
+        {
+            std::lock_guard<std::mutex> lock(conn->lock);
+            for (; i < n && jobs[order[i]].conn.get() == conn; ++i)
+            {
+                // nobody is left to write to a broken connection
+                if (conn->broken)
+                    --conn->in_flight;
+                else
+                    conn->outbox.push_back(responses[order[i]]);
+            }
+        }
+        conn->changed.notify_all();
+    }
+}
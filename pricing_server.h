@@ -0,0 +1,144 @@
+#ifndef PRICING_SERVER_H
+#define PRICING_SERVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "contract.h"
+#include "pricing_cache.h"
+
+/*
+    Wire format of the pricing daemon, in native byte order since both ends
+    run on the same machine. A client writes any number of Request records on
+    its connection and reads back one Response per request. Responses can come
+    back in a different order than the requests, id is there to match them up.
+*/
+struct Request
+{
+    uint32_t id;       // echoed back in the response
+    uint8_t product;   // one of Product
+    uint8_t pad[3];
+    int32_t steps;     // lattice products only
+    uint32_t reserved;
+    double S, K, r, q, sigma, t;
+};
+
+struct Response
+{
+    uint32_t id;
+    int32_t status; // one of Status
+    double price;
+};
+
+static_assert(sizeof(Request) == 64, "Request is 64 bytes on the wire");
+static_assert(sizeof(Response) == 16, "Response is 16 bytes on the wire");
+
+enum Status
+{
+    PRICE_OK = 0,
+    BAD_PRODUCT = 1,
+    BAD_INPUT = 2
+};
+
+// Largest lattice accepted from a client. A tree costs steps^2 / 2 node updates,
+// at this size about half a second of one worker, so a few large requests cannot
+// hold every worker for minutes
+const int max_request_steps = 1 << 14;
+
+// Responses a connection can have outstanding (read but not yet written back), past
+// that it is not read until its client reads, so a client that never reads stalls
+// only itself and its responses never take more than this much memory
+const size_t connection_window = 4096;
+
+class PricingServer
+{
+    struct Connection
+    {
+        int fd;
+        std::mutex lock;
+        std::condition_variable changed; // responses queued or written, or the connection is closing
+        std::vector<Response> outbox;    // priced, waiting for the writer
+        size_t in_flight;                // read but not yet written back, at most connection_window
+        bool reading;                    // the reader has not finished yet
+        bool broken;                     // a write failed, responses are dropped from then on
+        int handlers;                    // reader and writer threads still running, under conn_lock
+
+        Connection(int fd) : fd(fd), in_flight(0), reading(true), broken(false), handlers(2) {}
+        ~Connection();
+    };
+
+    struct Job
+    {
+        std::shared_ptr<Connection> conn;
+        Request req;
+    };
+
+    std::string path;
+    int workers, max_batch, threads;
+    size_t queue_capacity;
+    std::unique_ptr<PricingCache> cache;
+    int listen_fd;
+    std::atomic<bool> stopping;
+
+    /*
+        path - filesystem path of the Unix domain socket
+        workers - threads taking batches off the queue
+        max_batch - most requests priced in one batch
+        threads - threads each batch is spread over
+        queue_capacity - requests waiting to be priced before readers stop reading
+        cache - prices shared by all connections, null when the server runs without one
+    */
+
+    // Requests read off all connections, waiting for a worker
+    std::mutex queue_lock;
+    std::condition_variable not_empty, not_full;
+    std::deque<Job> queue;
+    bool draining;
+
+    // Open connections so they can be shut down on stop
+    std::mutex conn_lock;
+    std::condition_variable handlers_done;
+    std::map<int, std::weak_ptr<Connection>> connections;
+    int readers, writers;
+
+    // Totals reported when the server stops
+    std::atomic<long> served, batches;
+
+    // Reads requests off one connection and queues them, blocks while the queue or the connection's window is full
+    void read_loop(std::shared_ptr<Connection> conn);
+
+    // Writes the responses of one connection as workers queue them
+    void write_loop(std::shared_ptr<Connection> conn);
+
+    // Called by the reader and the writer of a connection as they finish, the last one forgets it
+    void handler_done(const std::shared_ptr<Connection> &conn, int &running);
+
+    // Takes whatever is queued (up to max_batch), prices it and hands the responses to the writers
+    void work_loop();
+
+    // Prices a batch over the worker's team and queues each connection its responses in one go,
+    // never blocks on a client
+    void price_jobs(std::vector<Job> &jobs, ThreadTeam &team);
+
+public:
+    // cache_entries of 0 prices every request
+    PricingServer(const std::string &path, int workers, int max_batch, int threads, int queue_capacity,
+                  size_t cache_entries = 0);
+    ~PricingServer();
+
+    // Binds and listens on path, replacing a stale socket file; prints the error and returns false on failure
+    bool start();
+
+    // Accepts connections and serves them until stop() is called
+    void run();
+
+    // Asks run() to finish, only sets a flag so it can be called from a signal handler
+    void stop() { stopping = true; }
+};
+#endif
@@ -0,0 +1,317 @@
+#include "vol_surface.h"
+#include "parallel.h"
+#include <algorithm>
+
+// Levenberg-Marquardt limits for one slice
+static const int max_iterations = 200;
+static const int max_damping_tries = 12;
+
+double svi_variance(const SviParams &p, double k)
+{
+    double x = k - p.m;
+    return p.a + p.b * (p.rho * x + std::sqrt(x * x + p.sigma * p.sigma));
+}
+
+// Total variance at k for parameters (a, b, rho, m, sigma) and its gradient with respect to them
+static double svi_gradient(const double *p, double k, double *grad)
+{
+    double x = k - p[3];
+    double root = std::sqrt(x * x + p[4] * p[4]);
+    grad[0] = 1.0;
+    grad[1] = p[2] * x + root;
+    grad[2] = p[1] * x;
+    grad[3] = -p[1] * (p[2] + x / root);
+    grad[4] = p[1] * p[4] / root;
+    return p[0] + p[1] * (p[2] * x + root);
+}
+
+// Keeps the parameters where the slice is a valid SVI smile with non negative variance
+static void project(double *p)
+{
+    p[1] = std::max(p[1], 0.0);
+    p[2] = std::min(std::max(p[2], -0.999), 0.999);
+    p[4] = std::max(p[4], 1e-4);
+    p[0] = std::max(p[0], -p[1] * p[4] * std::sqrt(1.0 - p[2] * p[2]));
+}
+
+// Solves the 5x5 system A x = y by Gaussian elimination with partial pivoting, A and y are overwritten
+static void solve5(double A[5][5], double *y, double *x)
+{
+    for (int col = 0; col < 5; ++col)
+    {
+        int pivot = col;
+        for (int row = col + 1; row < 5; ++row)
+            if (std::fabs(A[row][col]) > std::fabs(A[pivot][col]))
+                pivot = row;
+        std::swap(A[col], A[pivot]);
+        std::swap(y[col], y[pivot]);
+        if (std::fabs(A[col][col]) < 1e-300)
+            continue;
+        for (int row = col + 1; row < 5; ++row)
+        {
+            double f = A[row][col] / A[col][col];
+            for (int c = col; c < 5; ++c)
+                A[row][c] -= f * A[col][c];
+            y[row] -= f * y[col];
+        }
+    }
+    for (int col = 4; col >= 0; --col)
+    {
+        double sum = y[col];
+        for (int c = col + 1; c < 5; ++c)
+            sum -= A[col][c] * x[c];
+        x[col] = std::fabs(A[col][col]) < 1e-300 ? 0.0 : sum / A[col][col];
+    }
+}
+
+// Fewer quotes than that leave the five SVI parameters undetermined
+static const size_t min_quotes = 5;
+
+static bool valid_quotes(const SmileQuotes &quotes)
+{
+    if (!(quotes.t > 0.0) || !(quotes.forward > 0.0) || quotes.strikes.size() < min_quotes)
+        return false;
+    if (quotes.vols.size() != quotes.strikes.size())
+        return false;
+    if (!quotes.weights.empty() && quotes.weights.size() != quotes.strikes.size())
+        return false;
+    for (size_t i = 0; i < quotes.strikes.size(); ++i)
+    {
+        // the comparisons are false for NAN, and the upper bound rejects infinite vols
+        if (!(quotes.strikes[i] > 0.0) || !(quotes.vols[i] > 0.0) || !(quotes.vols[i] < INFINITY))
+            return false;
+        if (!quotes.weights.empty() && !(quotes.weights[i] >= 0.0 && quotes.weights[i] < INFINITY))
+            return false;
+    }
+    return true;
+}
+
+SviSlice fit_svi(const SmileQuotes &quotes, const SviParams *start)
+{
+    if (!valid_quotes(quotes))
+    {
+        SviSlice slice;
+        slice.t = quotes.t;
+        slice.forward = quotes.forward;
+        slice.params = {NAN, NAN, NAN, NAN, NAN};
+        slice.rmse = NAN;
+        slice.iterations = 0;
+        return slice;
+    }
+
+    int n = quotes.strikes.size();
+    std::vector<double> k(n), w(n), weight(n);
+    double w_min = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        k[i] = std::log(quotes.strikes[i] / quotes.forward);
+        w[i] = quotes.vols[i] * quotes.vols[i] * quotes.t;
+        weight[i] = quotes.weights.empty() ? 1.0 : quotes.weights[i];
+        w_min = i == 0 ? w[i] : std::min(w_min, w[i]);
+    }
+
+    // cold start, a smile centred at the money with its bottom at the lowest quote
+    double p[5] = {w_min - 0.01, 0.1, 0.0, 0.0, 0.1};
+    if (start)
+    {
+        p[0] = start->a;
+        p[1] = start->b;
+        p[2] = start->rho;
+        p[3] = start->m;
+        p[4] = start->sigma;
+    }
+    project(p);
+
+    auto cost = [&](const double *q)
+    {
+        double sum = 0.0, grad[5];
+        for (int i = 0; i < n; ++i)
+        {
+            double r = svi_gradient(q, k[i], grad) - w[i];
+            sum += weight[i] * r * r;
+        }
+        return sum;
+    };
+
+    double current = cost(p);
+    double lambda = 1e-3;
+    int it = 0;
+    for (; it < max_iterations && n > 0; ++it)
+    {
+        // normal equations from the analytic Jacobian
+        double JTJ[5][5] = {}, JTr[5] = {}, grad[5];
+        for (int i = 0; i < n; ++i)
+        {
+            double r = svi_gradient(p, k[i], grad) - w[i];
+            for (int a = 0; a < 5; ++a)
+            {
+                JTr[a] += weight[i] * grad[a] * r;
+                for (int b = 0; b <= a; ++b)
+                    JTJ[a][b] += weight[i] * grad[a] * grad[b];
+            }
+        }
+        for (int a = 0; a < 5; ++a)
+            for (int b = a + 1; b < 5; ++b)
+                JTJ[a][b] = JTJ[b][a];
+
+        bool improved = false;
+        double previous = current;
+        for (int tries = 0; tries < max_damping_tries && !improved; ++tries)
+        {
+            double A[5][5], y[5], step[5], trial[5];
+            for (int a = 0; a < 5; ++a)
+            {
+                for (int b = 0; b < 5; ++b)
+                    A[a][b] = JTJ[a][b];
+                A[a][a] += lambda * JTJ[a][a] + 1e-12;
+                y[a] = -JTr[a];
+            }
+            solve5(A, y, step);
+            for (int a = 0; a < 5; ++a)
+                trial[a] = p[a] + step[a];
+            project(trial);
+
+            double trial_cost = cost(trial);
+            if (trial_cost < current)
+            {
+                std::copy(trial, trial + 5, p);
+                current = trial_cost;
+                lambda = std::max(lambda / 3.0, 1e-12);
+                improved = true;
+            }
+            else
+                lambda *= 4.0;
+        }
+        if (!improved || previous - current <= 1e-12 * previous)
+            break;
+    }
+
+    SviSlice slice;
+    slice.t = quotes.t;
+    slice.forward = quotes.forward;
+    slice.params = {p[0], p[1], p[2], p[3], p[4]};
+    slice.iterations = it;
+
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        double vol = std::sqrt(std::max(svi_variance(slice.params, k[i]), 0.0) / quotes.t);
+        sum += (vol - quotes.vols[i]) * (vol - quotes.vols[i]);
+    }
+    slice.rmse = n > 0 ? std::sqrt(sum / n) : 0.0;
+    return slice;
+}
+
+// Expiries closer than this are the same expiry
+static const double same_expiry = 1e-9;
+
+void VolSurface::calibrate(const std::vector<SmileQuotes> &chain, int threads)
+{
+    // expiries in order of t, of several quotes for the same expiry the last one in the chain is kept
+    std::vector<int> order(chain.size());
+    for (size_t i = 0; i < chain.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return chain[a].t < chain[b].t; });
+    std::vector<int> kept;
+    for (size_t j = 0; j < order.size(); ++j)
+        if (j + 1 == order.size() || !(chain[order[j + 1]].t - chain[order[j]].t < same_expiry))
+            kept.push_back(order[j]);
+
+    int n = kept.size();
+    std::vector<SviSlice> fits(n);
+    parallel_ranges(n, threads, [&](int first, int last)
+    {
+        for (int j = first; j < last; ++j)
+        {
+            // warm start from the last fit of the same expiry
+            const SmileQuotes &quotes = chain[kept[j]];
+            const SviParams *start = nullptr;
+            for (const SviSlice &old : slices)
+                if (std::fabs(old.t - quotes.t) < same_expiry && std::isfinite(old.rmse))
+                    start = &old.params;
+            fits[j] = fit_svi(quotes, start);
+        }
+    });
+
+    slices.clear();
+    times.clear();
+    log_forwards.clear();
+    k_mins.clear();
+    dks.clear();
+    grid.clear();
+    points = std::max(points, 2);
+    for (int e = 0; e < n; ++e)
+    {
+        const SviSlice &fit = fits[e];
+        const SmileQuotes &quotes = chain[kept[e]];
+        slices.push_back(fit);
+        if (!std::isfinite(fit.rmse))
+            continue;
+
+        // log-moneyness range of this expiry's quotes and the money, with some room either side
+        double lo = 0.0, hi = 0.0;
+        for (double K : quotes.strikes)
+        {
+            double k = std::log(K / quotes.forward);
+            lo = std::min(lo, k);
+            hi = std::max(hi, k);
+        }
+        double room = hi > lo ? 0.1 * (hi - lo) : 0.05;
+        double k_min = lo - room, dk = (hi + room - k_min) / (points - 1);
+
+        times.push_back(fit.t);
+        log_forwards.push_back(std::log(fit.forward));
+        k_mins.push_back(k_min);
+        dks.push_back(dk);
+        for (int j = 0; j < points; ++j)
+            grid.push_back(std::max(svi_variance(fit.params, k_min + j * dk), 0.0));
+    }
+}
+
+double VolSurface::sigma(double K, double t) const
+{
+    int rows = times.size();
+    if (rows == 0 || !(t > 0.0) || !(K > 0.0))
+        return NAN;
+
+    // expiries either side of t, past the first and last the nearest one is used at constant volatility
+    int hi = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+    int lo = std::max(hi - 1, 0);
+    hi = std::min(hi, rows - 1);
+    double alpha = hi == lo ? 0.0 : (t - times[lo]) / (times[hi] - times[lo]);
+    alpha = std::min(std::max(alpha, 0.0), 1.0);
+
+    // forwards are log-linear in t, extrapolated with the carry of the nearest two expiries
+    double log_forward = log_forwards[lo];
+    if (rows > 1)
+    {
+        // calibrate keeps one row per expiry, the check only keeps a zero gap from giving an infinite carry
+        int a = std::min(lo, rows - 2);
+        double gap = times[a + 1] - times[a];
+        if (gap > 0.0)
+            log_forward = log_forwards[a] + (log_forwards[a + 1] - log_forwards[a]) / gap * (t - times[a]);
+    }
+
+    // the same log-moneyness on the grid of each of the two expiries
+    double k = std::log(K) - log_forward;
+    auto variance = [&](int row)
+    {
+        double x = (k - k_mins[row]) / dks[row];
+        x = std::min(std::max(x, 0.0), points - 1.0);
+        int j = std::min((int)x, points - 2);
+        double f = x - j;
+        const double *w = &grid[row * points];
+        return w[j] + f * (w[j + 1] - w[j]);
+    };
+    double w_lo = variance(lo);
+    double w_hi = variance(hi);
+
+    double w;
+    if (t < times[lo])
+        w = w_lo * t / times[lo];
+    else if (t > times[hi])
+        w = w_hi * t / times[hi];
+    else
+        w = w_lo + alpha * (w_hi - w_lo);
+    return std::sqrt(w / t);
+}
@@ -0,0 +1,72 @@
+#ifndef VOL_SURFACE_H
+#define VOL_SURFACE_H
+
+#include <vector>
+#include "contract.h"
+
+// Quotes of one expiry of an option chain
+struct SmileQuotes
+{
+    double t, forward;
+    std::vector<double> strikes, vols, weights;
+
+    /*
+        t - time to expiration (years)
+        forward - forward price of the underlying for t
+        strikes, vols - quoted strikes and their implied volatilities
+        weights - weight of each quote in the fit, empty weighs them all the same
+    */
+};
+
+// Raw SVI total variance w(k) = a + b * (rho * (k - m) + sqrt((k - m)^2 + sigma^2)), k = log(K / forward)
+struct SviParams
+{
+    double a, b, rho, m, sigma;
+};
+
+double svi_variance(const SviParams &p, double k);
+
+struct SviSlice
+{
+    double t, forward;
+    SviParams params;
+    double rmse;    // root mean square error of the fitted implied volatilities
+    int iterations; // Levenberg-Marquardt iterations taken
+};
+
+// Least squares fit of one expiry in total variance, starting from start when given
+// (the previous fit of the same expiry) and from a guess off the quotes otherwise.
+// Quotes with fewer than 5 strikes (one per parameter), t or forward not positive, a non
+// positive strike, a vol not positive and finite, a negative or non finite weight, or vols
+// (and weights when given) not the length of strikes give a slice with NAN params and rmse
+SviSlice fit_svi(const SmileQuotes &quotes, const SviParams *start = nullptr);
+
+class VolSurface
+{
+    std::vector<SviSlice> slices;
+
+    // Total variance on a grid of log-moneyness k_mins[row] + j * dks[row] (j < points), one row
+    // per fitted expiry, each spanning the quoted strikes of its own expiry
+    std::vector<double> times, log_forwards, k_mins, dks, grid;
+    int points;
+
+public:
+    // points - grid points per expiry
+    VolSurface(int points = 512) : points(points) {}
+
+    // Fits every expiry of a chain spread over threads, each one warm started from the
+    // previous fit of the same expiry, then rebuilds the grid from the slices that fitted.
+    // Not safe to run while other threads call sigma() on the same surface.
+    void calibrate(const std::vector<SmileQuotes> &chain, int threads = 1);
+
+    const std::vector<SviSlice> &fitted() const { return slices; }
+
+    // Volatility for strike K and time to expiration t, interpolated in total variance
+    // linearly across expiries and log-moneyness, flat past the edges of the grid.
+    // NAN for K or t not positive and before any expiry has fitted
+    double sigma(double K, double t) const;
+
+    // Sets c.sigma from the surface, ready for price_contract or set_sigma
+    void mark(Contract &c) const { c.sigma = sigma(c.K, c.t); }
+};
+#endif